@@ -2,10 +2,21 @@
 #define WIN32_LEAN_AND_MEAN
 #define RAPIDJSON_HAS_STDSTRING true
 #include <vector>
+#include <deque>
+#include <thread>
+#include <atomic>
+#include <limits>
+#include <algorithm>
+#include <cmath>
 #include <iostream>
+#include <unordered_map>
+#include <unordered_set>
+#include <winsock2.h>
+#include <afunix.h>
 #include <Windows.h>
 #include <rapidjson/filereadstream.h>
 #include <rapidjson/filewritestream.h>
+#include <rapidjson/memorybuffer.h>
 #include <rapidjson/document.h>
 #include <rapidjson/writer.h>
 #include <SFML/Graphics.hpp>
@@ -19,11 +30,18 @@ volatile bool pressed = false;
 volatile uint16_t reallocCount = 0;
 #endif
 
+void invalidate(int top, int bottom);
+
 void error(const std::wstring error) {
   MessageBoxW(NULL, error.c_str(), L"Progress error!", MB_ICONERROR | MB_OK);
   abort();
 }
 
+//Non-fatal error, app keeps running
+void warning(const std::wstring warning) {
+  MessageBoxW(NULL, warning.c_str(), L"Progress warning!", MB_ICONWARNING | MB_OK);
+}
+
 class Tree {
   //Render
   sf::VertexBuffer bar_;
@@ -40,6 +58,8 @@ class Tree {
 
   //Container
   std::vector<std::unique_ptr<Tree>> tree_;
+  Tree* parent_ = nullptr;
+  std::unique_ptr<std::unordered_multimap<std::wstring, Tree*>> index_; //Children by name, built by first getChild()
 
   //Mode
   sf::Vector2i position_;
@@ -54,6 +74,10 @@ class Tree {
   bool isDeleted_ = false;
   bool isDone_ = false;     //Is check mark set
   uint8_t percentValue_ = 0;
+  float progress_ = 0.0F;      //Exact percent for the bar
+  std::size_t doneCount_ = 0;  //Checked items in subtree
+  std::size_t totalCount_ = 0; //Items in subtree
+  std::size_t rows_ = 0;       //Rows below this one when expanded
 public:
   Tree() {
 #ifdef DEBUG
@@ -68,6 +92,16 @@ public:
     std::wcout << L"~Tree(): Destructor" << std::endl;
     reallocCount++;
 #endif // DEBUG
+    //Unlink descendants first so deep trees are not destroyed recursively
+    std::vector<std::unique_ptr<Tree>> garbage = std::move(tree_);
+    while(!garbage.empty()) {
+      std::unique_ptr<Tree> node = std::move(garbage.back());
+      garbage.pop_back();
+      for(auto& i : node->tree_) {
+        garbage.push_back(std::move(i));
+      }
+      node->tree_.clear();
+    }
     if(vtBar_) {
       delete[] vtBar_;
       vtBar_ = nullptr;
@@ -107,7 +141,67 @@ private:
   }
 public:
 
+  //Depth-first walk with an explicit stack, so nesting depth is not limited by
+  //the call stack. enter(node, depth) runs before the children and returns whether
+  //to visit them, leave(node, depth) runs after them for visited nodes only.
+  //range(node) gives the [begin, end) children indices to visit.
+  template<typename Node, typename Enter, typename Leave, typename Range>
+  static void traverse(Node& root, Enter enter, Leave leave, Range range) {
+    struct Frame {
+      Node* node;
+      std::size_t index;
+      std::size_t end;
+    };
+    std::vector<Frame> stack;
+
+    auto push = [&stack, &enter, &range](Node& node) {
+      if(enter(node, stack.size())) {
+        const std::pair<std::size_t, std::size_t> children = range(node);
+        stack.push_back(Frame{&node, children.first, children.second});
+      }
+    };
+
+    push(root);
+    while(!stack.empty()) {
+      Frame& frame = stack.back();
+      if(frame.index < frame.end) {
+        push(*frame.node->tree_[frame.index++]);
+      }
+      else {
+        Node& node = *frame.node;
+        stack.pop_back();
+        leave(node, stack.size());
+      }
+    }
+  }
+
+  template<typename Node, typename Enter, typename Leave>
+  static void traverse(Node& root, Enter enter, Leave leave) {
+    traverse(root, enter, leave, [](Node& node) {
+      return std::pair<std::size_t, std::size_t>(0, node.tree_.size());
+    });
+  }
+
   void load(rapidjson::GenericValue<rapidjson::UTF16LE<>>& reader) {
+    //Value of each node on the current path and index of its next child value
+    std::vector<std::pair<rapidjson::GenericValue<rapidjson::UTF16LE<>>*, rapidjson::SizeType>> values;
+    traverse(*this, [&values, &reader](Tree& node, std::size_t depth) {
+      rapidjson::GenericValue<rapidjson::UTF16LE<>>* value = &reader;
+      if(depth != 0) {
+        auto& parent = values[depth - 1];
+        value = &(*parent.first)[L"data"][parent.second++];
+      }
+      values.resize(depth);
+      values.emplace_back(value, 0);
+      node.loadNode(*value);
+      return node.isFolder_;
+    }, [](Tree&, std::size_t) {
+    });
+  }
+private:
+
+  //Reads own members and creates empty children for the data array
+  void loadNode(rapidjson::GenericValue<rapidjson::UTF16LE<>>& reader) {
     if(!reader.IsObject()) {
       error(L"Not an object");
     }
@@ -141,9 +235,10 @@ public:
       else {
         tree_.reserve(size);
       }
+      index_.reset();
       for(rapidjson::SizeType i = 0; i < size; ++i) {
         tree_.emplace_back(new Tree);
-        tree_.back()->load(reader[L"data"][i]);
+        tree_.back()->parent_ = this;
       }
       if(reader.HasMember(L"show")) {
         if(!reader[L"show"].IsBool()) {
@@ -159,8 +254,12 @@ public:
       isDone_ = reader[L"data"].GetBool();
     }
   }
+public:
 
-  void save(rapidjson::Writer<rapidjson::EncodedOutputStream<rapidjson::UTF16LE<>, rapidjson::FileWriteStream>, rapidjson::UTF16LE<>, rapidjson::UTF16LE<>>& writer) const {
+  //Writes object start, name, type and for folders opens the "data" array
+  template<typename Writer>
+  void saveHead(Writer& writer) const {
+    writer.StartObject();
     writer.Key(L"name");
     writer.String(name_.getString().toWideString());
     writer.Key(L"type");
@@ -170,17 +269,23 @@ public:
       writer.Bool(isVisible_);
       writer.Key(L"data");
       writer.StartArray();
-      for(std::size_t i = 0; i < tree_.size(); ++i) {
-        writer.StartObject();
-        tree_[i]->save(writer);
+    }
+  }
+
+  template<typename Writer>
+  void save(Writer& writer) const {
+    traverse(*this, [&writer](const Tree& node, std::size_t) {
+      node.saveHead(writer);
+      if(!node.isFolder_) {
+        writer.Key(L"data");
+        writer.Bool(node.isDone_);
         writer.EndObject();
       }
+      return node.isFolder_;
+    }, [&writer](const Tree&, std::size_t) {
       writer.EndArray();
-    }
-    else {
-      writer.Key(L"data");
-      writer.Bool(isDone_);
-    }
+      writer.EndObject();
+    });
   }
 
   inline void setRoot() {
@@ -203,8 +308,65 @@ public:
     isFolder_ = isFolder;
   }
 
+  //Places this row and every row of the subtree below it
   void setPosition(const sf::Vector2i position) {
+    //Next free row of each node on the current path
+    std::vector<int> next;
+    traverse(*this, [&next, position](Tree& node, std::size_t depth) {
+      sf::Vector2i row = position;
+      if(depth != 0) {
+        row.x += static_cast<int>(depth) * 10;
+        row.y = next[depth - 1];
+      }
+      node.place(row);
+      next.resize(depth);
+      next.push_back(row.y + 30);
+      return true;
+    }, [&next](Tree& node, std::size_t depth) {
+      node.rows_ = static_cast<std::size_t>(next[depth] - node.position_.y - 30) / 30;
+      node.percentUpdate();
+      if(depth != 0) {
+        next[depth - 1] = node.isVisible_ ? next[depth] : node.position_.y + 30;
+      }
+    });
+  }
+private:
+
+  //Shifts this row vertically, keeping its vertex buffers
+  void move(int dy) {
+    invalidate(position_.y, position_.y + 30);
+    position_.y += dy;
+    invalidate(position_.y, position_.y + 30);
+
+    name_.setPosition(sf::Vector2f(position_) + sf::Vector2f(2, 0));
+
+    const float offset = static_cast<float>(dy);
+    barRect_.top += dy;
+    for(uint8_t i = 0; i < 8; ++i) {
+      vtBar_[i].position.y += offset;
+    }
+    bar_.update(vtBar_);
+
+    for(uint8_t i = 0; i < (isFolder_ ? 5 : 3); ++i) {
+      buttonsRects_[i].top += dy;
+      for(uint8_t j = 0; j < 4; ++j) {
+        vtButton_[i * 4 + j].position.y += offset;
+      }
+    }
+    buttons_.update(vtButton_);
+
+    if(vtPercent_) {
+      for(std::size_t i = 0; i < percent_.getVertexCount(); ++i) {
+        vtPercent_[i].position.y += offset;
+      }
+      percent_.update(vtPercent_);
+    }
+  }
+
+  void place(const sf::Vector2i position) {
+    invalidate(position_.y, position_.y + 30);
     position_ = position;
+    invalidate(position_.y, position_.y + 30);
 
     name_.setPosition(sf::Vector2f(position_) + sf::Vector2f(2, 0));
 
@@ -297,69 +459,163 @@ public:
       buttonsRects_[i] = sf::IntRect(position_.x + 410 + i * 30, position_.y, 20, 20);
     }
     buttons_.update(vtButton_);
+  }
+public:
+
+  void setName(const sf::String& name) {
+    rename(name);
+    invalidate(position_.y, position_.y + 30);
+  }
 
-    for(std::size_t i = 0; i < tree_.size(); ++i) {
-      tree_[i]->setPosition(
-        sf::Vector2i(
-        position_.x + 10,
-        i == 0 ? position_.y + 30 : tree_[i - 1]->getPosition().y + (tree_[i - 1]->getHeight() + 1) * 30
-      )
-      );
+  inline void setCheckValue(bool isDone) {
+    if(isFolder_) {
+      throw std::logic_error("is a folder");
     }
-    percentUpdate();
+    isDone_ = isDone;
+  }
+
+  //Appends positioned child, caller updates percent
+  Tree* add(bool isFolder) {
+    tree_.emplace_back(new Tree);
+    tree_.back()->parent_ = this;
+    if(index_) {
+      index_->emplace(tree_.back()->getName().toWideString(), tree_.back().get());
+    }
+    tree_.back()->setIsFolder(isFolder);
+    tree_.back()->setVisible(true);
+    tree_.back()->setPosition(sf::Vector2i(position_.x + 10, tree_.size() == 1 ? position_.y + 30 : (*(tree_.end() - 2))->getPosition().y + ((*(tree_.end() - 2))->getHeight() + 1) * 30));
+    ++rows_;
+    return tree_.back().get();
+  }
+
+  //Flags this row for layout by the parent, applied by reflow()
+  inline void setChanged() {
+    isChanged_ = true;
+  }
+
+  //Flags this row for removal by the parent, applied by reflow()
+  void setDeleted() {
+    isDeleted_ = true;
+    invalidate(position_.y, std::numeric_limits<int>::max());
+  }
+
+  //Applies rows flagged by setChanged() and setDeleted() in one pass
+  void reflow() {
+    traverse(*this, [](Tree& node, std::size_t) {
+      return node.isChanged_ && node.isFolder_;
+    }, [](Tree& node, std::size_t) {
+      node.childrenUpdate();
+    });
+    isChanged_ = false;
+  }
+
+  //First child with given name, deleted children are skipped
+  Tree* getChild(const std::wstring& name) {
+    if(!index_) {
+      index_.reset(new std::unordered_multimap<std::wstring, Tree*>);
+      index_->reserve(tree_.size());
+      for(auto& i : tree_) {
+        index_->emplace(i->getName().toWideString(), i.get());
+      }
+    }
+    //Siblings are sorted by y, so the topmost match comes first in the list
+    Tree* out = nullptr;
+    auto range = index_->equal_range(name);
+    for(auto i = range.first; i != range.second; ++i) {
+      if(!i->second->isDeleted_ && (!out || i->second->position_.y < out->position_.y)) {
+        out = i->second;
+      }
+    }
+    return out;
   }
 
-  inline bool getChanged() {
+  inline bool getChanged() const {
     return isChanged_;
   }
 
-  inline bool getDeleted() {
+  inline bool getDeleted() const {
     return isDeleted_;
   }
 
-  inline bool getIsFolder() {
+  inline bool getIsFolder() const {
     return isFolder_;
   }
 
-  inline bool getCheckValue() {
+  inline bool getCheckValue() const {
     return isDone_;
   }
 
-  inline sf::Vector2i getPosition() {
+  inline sf::Vector2i getPosition() const {
     return position_;
   }
 
-  inline uint8_t getPercent() {
+  inline uint8_t getPercent() const {
     return percentValue_;
   }
 
-  std::size_t getHeight() {
-    if(!isVisible_) {
-      return 0;
-    }
-    std::size_t out = tree_.size();
-    for(auto& i : tree_) {
-      out += i->getHeight();
-    }
-    return out;
+  inline const sf::String& getName() const {
+    return name_.getString();
+  }
+
+  inline const std::vector<std::unique_ptr<Tree>>& getChildren() const {
+    return tree_;
+  }
+
+  inline std::size_t getDoneCount() const {
+    return doneCount_;
+  }
+
+  inline std::size_t getTotalCount() const {
+    return totalCount_;
+  }
+
+  //Empty folder is shown at 0% so it is not complete
+  inline bool getComplete() const {
+    return doneCount_ == totalCount_ && (totalCount_ != 0 || !isFolder_);
+  }
+
+  //Rows shown below this one
+  inline std::size_t getHeight() const {
+    return isVisible_ ? rows_ : 0;
   }
 
   void percentUpdate() {
-    float percent = isDone_ ? 100.0F : 0.0F;
+    percentCompute();
+    percentRebuild();
+  }
+
+  //Counts and percent only, deleted children are left out
+  void percentCompute() {
+    progress_ = isDone_ ? 100.0F : 0.0F;
+    doneCount_ = isDone_ ? 1 : 0;
+    totalCount_ = 1;
     if(isFolder_) {
       float x = 0.0F;
-      percent = 100.0F / static_cast<float>(tree_.size());
+      std::size_t size = 0;
+      doneCount_ = 0;
+      totalCount_ = 0;
       for(auto& i : tree_) {
+        if(i->isDeleted_) {
+          continue;
+        }
+        ++size;
         if(i->getIsFolder()) {
           x += i->getPercent() / 100.0F;
         }
         else {
           x += i->getCheckValue() ? 1.0F : 0.0F;
         }
+        doneCount_ += i->getDoneCount();
+        totalCount_ += i->getTotalCount();
       }
-      percent *= x;
-      percentValue_ = static_cast<uint8_t>(percent);
+      progress_ = size != 0 ? 100.0F / static_cast<float>(size) * x : 0.0F;
+      percentValue_ = static_cast<uint8_t>(progress_);
+    }
+  }
 
+  //Vertices of the percent digits and the bar
+  void percentRebuild() {
+    if(isFolder_) {
       std::string percentString = std::to_string(percentValue_) + "%";
       uint8_t lenght = static_cast<uint8_t>(percentString.length());
       percent_.create(static_cast<std::size_t>(lenght) * 4);
@@ -400,7 +656,7 @@ public:
     }
     percent_.update(vtPercent_);
 
-    float progress = 396.0F * (percent / 100.0F);
+    float progress = 396.0F * (progress_ / 100.0F);
     vtBar_[4].position.x = static_cast<float>(position_.x + 2);
     vtBar_[4].position.y = static_cast<float>(position_.y + 2);
 
@@ -413,9 +669,48 @@ public:
     vtBar_[7].position.x = static_cast<float>(position_.x + progress + 2);
     vtBar_[7].position.y = static_cast<float>(position_.y + 2);
     bar_.update(vtBar_);
+    invalidate(position_.y, position_.y + 30);
   }
 
   bool event(sf::Event& event, sf::RenderWindow& window) {
+    bool out = false;
+    traverse(*this, [&out, &event, &window](Tree& node, std::size_t) {
+      out = node.handle(event, window) || out;
+      return node.isVisible_ && node.isFolder_;
+    }, [](Tree& node, std::size_t) {
+      node.childrenUpdate();
+    });
+    return out;
+  }
+
+  void draw(sf::RenderTarget& target) {
+    const sf::View& view = target.getView();
+    const int top = static_cast<int>(view.getCenter().y - view.getSize().y / 2.0F);
+    const int bottom = static_cast<int>(view.getCenter().y + view.getSize().y / 2.0F) + 1;
+
+    //Children are sorted by y, so each child's subtree ends where its next
+    //sibling starts. Visit only those intersecting [top, bottom)
+    traverse(*this, [&target, top, bottom](Tree& node, std::size_t) {
+      node.drawRow(target, top, bottom);
+      return node.isVisible_;
+    }, [](Tree&, std::size_t) {
+    }, [top, bottom](Tree& node) {
+      auto begin = std::upper_bound(node.tree_.begin(), node.tree_.end(), top, [](int y, const std::unique_ptr<Tree>& i) {
+        return y < i->position_.y;
+      });
+      if(begin != node.tree_.begin()) {
+        --begin;
+      }
+      auto end = std::lower_bound(begin, node.tree_.end(), bottom, [](const std::unique_ptr<Tree>& i, int y) {
+        return i->position_.y < y;
+      });
+      return std::pair<std::size_t, std::size_t>(begin - node.tree_.begin(), end - node.tree_.begin());
+    });
+  }
+private:
+
+  //Handles event for this row only
+  bool handle(sf::Event& event, sf::RenderWindow& window) {
     isChanged_ = false;
     bool out = false;
     switch(event.type) {
@@ -435,6 +730,8 @@ public:
           else {
             isDone_ = !isDone_;
           }
+          place(position_);
+          percentUpdate();
           isChanged_ = true;
           out = true;
         }
@@ -445,19 +742,13 @@ public:
         if(isProperty_) {
           if(isFolder_) {
             if(buttonsRects_[1].contains(mousePos)) {
-              tree_.emplace_back(new Tree);
-              tree_.back()->setIsFolder(false);
-              tree_.back()->setVisible(true);
-              tree_.back()->setPosition(sf::Vector2i(position_.x + 10, tree_.size() == 1 ? position_.y + 30 : (*(tree_.end() - 2))->getPosition().y + ((*(tree_.end() - 2))->getHeight() + 1) * 30));
+              add(false);
               percentUpdate();
               isChanged_ = true;
               out = true;
             }
             else if(buttonsRects_[2].contains(mousePos)) {
-              tree_.emplace_back(new Tree);
-              tree_.back()->setIsFolder(true);
-              tree_.back()->setVisible(true);
-              tree_.back()->setPosition(sf::Vector2i(position_.x + 10, tree_.size() == 1 ? position_.y + 30 : (*(tree_.end() - 2))->getPosition().y + ((*(tree_.end() - 2))->getHeight() + 1) * 30));
+              add(true);
               percentUpdate();
               isChanged_ = true;
               out = true;
@@ -503,7 +794,7 @@ public:
                 break;
               }
               name.erase(name.end() - 1);
-              name_.setString(name);
+              rename(name);
             }
             out = true;
             break;
@@ -519,7 +810,7 @@ public:
                 break;
               }
               name += event.text.unicode;
-              name_.setString(name);
+              rename(name);
               out = true;
             }
             break;
@@ -529,48 +820,402 @@ public:
       }
     }
 
-    if(isVisible_ && isFolder_) {
-      for(std::size_t i = 0; i < tree_.size(); ++i) {
-        out = tree_[i]->event(event, window) || out;
-        if(tree_[i]->getDeleted()) {
-          isChanged_ = true;
-          tree_.erase(tree_.begin() + i);
-          for(std::size_t j = i; j < tree_.size(); ++j) {
-            tree_[j]->setPosition(sf::Vector2i(position_.x + 10, j == 0 ? position_.y + 30 : tree_[j - 1]->getPosition().y + (tree_[j - 1]->getHeight() + 1) * 30));
-          }
-          percentUpdate();
-          --i;
-          continue;
-        }
-        if(tree_[i]->getChanged()) {
-          isChanged_ = true;
-          for(std::size_t j = i; j < tree_.size(); ++j) {
-            tree_[j]->setPosition(sf::Vector2i(position_.x + 10, j == 0 ? position_.y + 30 : tree_[j - 1]->getPosition().y + (tree_[j - 1]->getHeight() + 1) * 30));
-          }
-          percentUpdate();
-        }
-      }
+    //Height changes shift every row below, other changes touch only this row
+    if(isChanged_ || isDeleted_) {
+      invalidate(position_.y, std::numeric_limits<int>::max());
+    }
+    else if(out) {
+      invalidate(position_.y, position_.y + 30);
     }
+
     return out;
   }
 
-  void draw(sf::RenderWindow& window) {
-    if(isVisible_) {
-      for(auto& i : tree_) {
-        i->draw(window);
+  //Sets name and keeps the parent's name index current
+  void rename(const sf::String& name) {
+    if(parent_ && parent_->index_) {
+      parent_->unindex(this);
+      parent_->index_->emplace(name.toWideString(), this);
+    }
+    name_.setString(name);
+  }
+
+  //Removes child from the name index under its current name
+  void unindex(Tree* child) {
+    auto range = index_->equal_range(child->getName().toWideString());
+    for(auto i = range.first; i != range.second; ++i) {
+      if(i->second == child) {
+        index_->erase(i);
+        break;
+      }
+    }
+  }
+
+  //Drops deleted children and shifts rows below the first changed one.
+  //Changed children have already laid out their own subtrees
+  void childrenUpdate() {
+    std::size_t first = 0;
+    while(first < tree_.size() && !tree_[first]->isDeleted_ && !tree_[first]->isChanged_) {
+      ++first;
+    }
+    if(first == tree_.size()) {
+      return;
+    }
+    isChanged_ = true;
+    tree_.erase(std::remove_if(tree_.begin() + first, tree_.end(), [this](const std::unique_ptr<Tree>& node) {
+      if(node->isDeleted_ && index_) {
+        unindex(node.get());
+      }
+      return node->isDeleted_;
+    }), tree_.end());
+
+    //Rows before first keep their place, the rest follow them
+    int next = first == 0 ? position_.y + 30 : tree_[first - 1]->position_.y + static_cast<int>(tree_[first - 1]->getHeight() + 1) * 30;
+    int dy = 0;
+    traverse(*this, [&next, &dy](Tree& node, std::size_t depth) {
+      if(depth == 0) {
+        return true;
+      }
+      if(depth == 1) {
+        node.isChanged_ = false;
+        dy = next - node.position_.y;
+        next += static_cast<int>(node.getHeight() + 1) * 30;
+        if(dy == 0) {
+          return false;
+        }
       }
+      node.move(dy);
+      return true;
+    }, [](Tree&, std::size_t) {
+    }, [this, first](Tree& node) {
+      return std::pair<std::size_t, std::size_t>(&node == this ? first : 0, node.tree_.size());
+    });
+    rows_ = static_cast<std::size_t>(next - position_.y - 30) / 30;
+    percentUpdate();
+  }
+
+  void drawRow(sf::RenderTarget& target, int top, int bottom) {
+    if(position_.y + 30 <= top || position_.y >= bottom) {
+      return;
     }
-    window.draw(bar_);
+    target.draw(bar_);
     if(isProperty_) {
-      window.draw(buttons_, texture);
+      target.draw(buttons_, texture);
     }
     else {
-      window.draw(buttons_, 0, 4, texture);
+      target.draw(buttons_, 0, 4, texture);
     }
     if(isFolder_) {
-      window.draw(percent_, texture);
+      target.draw(percent_, texture);
+    }
+    target.draw(name_);
+  }
+};
+
+//Caches rendered rows in fixed-height render textures, so scrolling only blits them
+class TileCache {
+  static constexpr int tileWidth_ = 800;
+  static constexpr int tileHeight_ = 300;
+  static constexpr std::size_t tileCount_ = 6;
+
+  struct Tile {
+    sf::RenderTexture texture;
+    sf::Sprite sprite;
+    int index = -1;
+    bool isDirty = true;
+    uint64_t used = 0;
+  };
+
+  Tile tiles_[tileCount_];
+  uint64_t frame_ = 0;
+  sf::Color background_;
+public:
+  TileCache(const sf::Color background) : background_(background) {
+    for(auto& i : tiles_) {
+      if(!i.texture.create(tileWidth_, tileHeight_)) {
+        error(L"Cannot create render texture");
+      }
+      i.sprite.setTexture(i.texture.getTexture());
+    }
+  }
+
+  void invalidate(int top, int bottom) {
+    for(auto& i : tiles_) {
+      if(i.index < 0) {
+        continue;
+      }
+      const int tileTop = i.index * tileHeight_;
+      if(tileTop < bottom && tileTop + tileHeight_ > top) {
+        i.isDirty = true;
+      }
+    }
+  }
+
+  void draw(sf::RenderTarget& target, Tree& tree) {
+    ++frame_;
+    const sf::View& view = target.getView();
+    const float top = view.getCenter().y - view.getSize().y / 2.0F;
+    const float bottom = view.getCenter().y + view.getSize().y / 2.0F;
+    const int first = static_cast<int>(std::floor(top / tileHeight_));
+    const int last = static_cast<int>(std::floor(bottom / tileHeight_));
+    for(int i = first; i <= last; ++i) {
+      Tile& tile = get(i);
+      if(tile.isDirty) {
+        tile.texture.clear(background_);
+        tile.texture.setView(sf::View(sf::FloatRect(0.0F, static_cast<float>(i * tileHeight_), static_cast<float>(tileWidth_), static_cast<float>(tileHeight_))));
+        tree.draw(tile.texture);
+        tile.texture.display();
+        tile.isDirty = false;
+      }
+      target.draw(tile.sprite);
+    }
+  }
+private:
+
+  Tile& get(int index) {
+    Tile* out = &tiles_[0];
+    for(auto& i : tiles_) {
+      if(i.index == index) {
+        out = &i;
+        break;
+      }
+      if(i.used < out->used) {
+        out = &i;
+      }
+    }
+    if(out->index != index) {
+      out->index = index;
+      out->isDirty = true;
+      out->sprite.setPosition(0.0F, static_cast<float>(index * tileHeight_));
+    }
+    out->used = frame_;
+    return *out;
+  }
+};
+
+TileCache* tiles = nullptr;
+
+void invalidate(int top, int bottom) {
+  if(tiles) {
+    tiles->invalidate(top, bottom);
+  }
+}
+
+enum class ReportFormat : uint8_t {
+  CSV,
+  Markdown,
+  HTML
+};
+
+//Streams a depth-first walk of the tree to a file through a fixed buffer
+class Report {
+  FILE* file_ = nullptr;
+  ReportFormat format_ = ReportFormat::CSV;
+  std::size_t size_ = 0;
+  char buff_[4096]{};
+public:
+  Report(FILE* file, ReportFormat format) : file_(file), format_(format) {
+  }
+
+  ~Report() {
+    flush();
+  }
+
+  void write(const Tree& tree, bool incompleteOnly, std::size_t maxDepth) {
+    begin();
+
+    //Walk keeps one frame per nesting level, never the whole tree
+    Tree::traverse(tree, [this, incompleteOnly, maxDepth](const Tree& node, std::size_t depth) {
+      if(incompleteOnly && node.getComplete()) {
+        return false;
+      }
+      enter(node, depth, maxDepth);
+      return node.getIsFolder() && depth < maxDepth && !node.getChildren().empty();
+    }, [this](const Tree&, std::size_t) {
+      leave();
+    });
+
+    end();
+    flush();
+  }
+private:
+
+  void begin() {
+    switch(format_) {
+      case ReportFormat::CSV:
+        put("depth,type,name,done,total,percent\n");
+        break;
+      case ReportFormat::Markdown:
+        put("# Progress report\n\n");
+        break;
+      case ReportFormat::HTML:
+        put("<!DOCTYPE html>\n<html>\n<head>\n<meta charset=\"utf-8\">\n<title>Progress report</title>\n</head>\n<body>\n<ul>\n");
+        break;
+    }
+  }
+
+  void end() {
+    if(format_ == ReportFormat::HTML) {
+      put("</ul>\n</body>\n</html>\n");
+    }
+  }
+
+  void enter(const Tree& node, std::size_t depth, std::size_t maxDepth) {
+    const uint8_t percent = node.getIsFolder() ? node.getPercent() : (node.getCheckValue() ? 100 : 0);
+    switch(format_) {
+      case ReportFormat::CSV:
+        putNumber(depth);
+        put(node.getIsFolder() ? ",folder,\"" : ",item,\"");
+        putName(node.getName());
+        put("\",");
+        putNumber(node.getDoneCount());
+        put(',');
+        putNumber(node.getTotalCount());
+        put(',');
+        putNumber(percent);
+        put('\n');
+        break;
+      case ReportFormat::Markdown:
+        for(std::size_t i = 0; i < depth; ++i) {
+          put("  ");
+        }
+        if(node.getIsFolder()) {
+          put("- **");
+          putName(node.getName());
+          put("** ");
+          putNumber(node.getDoneCount());
+          put('/');
+          putNumber(node.getTotalCount());
+          put(" (");
+          putNumber(percent);
+          put("%)\n");
+        }
+        else {
+          put(node.getCheckValue() ? "- [x] " : "- [ ] ");
+          putName(node.getName());
+          put('\n');
+        }
+        break;
+      case ReportFormat::HTML:
+        put("<li>");
+        if(node.getIsFolder()) {
+          put("<b>");
+          putName(node.getName());
+          put("</b> <progress max=\"100\" value=\"");
+          putNumber(percent);
+          put("\"></progress> ");
+          putNumber(node.getDoneCount());
+          put('/');
+          putNumber(node.getTotalCount());
+          put(" (");
+          putNumber(percent);
+          put("%)");
+          if(depth < maxDepth && !node.getChildren().empty()) {
+            put("\n<ul>\n");
+            return;
+          }
+        }
+        else {
+          put(node.getCheckValue() ? "<input type=\"checkbox\" disabled checked> " : "<input type=\"checkbox\" disabled> ");
+          putName(node.getName());
+        }
+        put("</li>\n");
+        break;
+    }
+  }
+
+  //Closes folder whose children were written
+  void leave() {
+    if(format_ == ReportFormat::HTML) {
+      put("</ul>\n</li>\n");
+    }
+  }
+
+  void flush() {
+    if(size_ != 0) {
+      fwrite(buff_, 1, size_, file_);
+      size_ = 0;
+    }
+  }
+
+  inline void put(char ch) {
+    if(size_ == sizeof(buff_)) {
+      flush();
+    }
+    buff_[size_++] = ch;
+  }
+
+  void put(const char* str) {
+    while(*str) {
+      put(*str++);
+    }
+  }
+
+  void putNumber(std::size_t value) {
+    char digits[20];
+    uint8_t lenght = 0;
+    do {
+      digits[lenght++] = static_cast<char>('0' + value % 10);
+      value /= 10;
+    } while(value != 0);
+    while(lenght != 0) {
+      put(digits[--lenght]);
+    }
+  }
+
+  //Encodes UTF-32 name as UTF-8 and escapes it for the output format
+  void putName(const sf::String& name) {
+    for(const sf::Uint32 ch : name) {
+      switch(format_) {
+        case ReportFormat::CSV:
+          if(ch == '"') {
+            put("\"\"");
+            continue;
+          }
+          break;
+        case ReportFormat::Markdown:
+          if(ch == '\\' || ch == '`' || ch == '*' || ch == '_' || ch == '[' || ch == ']' || ch == '<' || ch == '>' || ch == '#' || ch == '|') {
+            put('\\');
+          }
+          break;
+        case ReportFormat::HTML:
+          if(ch == '&') {
+            put("&amp;");
+            continue;
+          }
+          if(ch == '<') {
+            put("&lt;");
+            continue;
+          }
+          if(ch == '>') {
+            put("&gt;");
+            continue;
+          }
+          if(ch == '"') {
+            put("&quot;");
+            continue;
+          }
+          break;
+      }
+      if(ch < 0x80) {
+        put(static_cast<char>(ch));
+      }
+      else if(ch < 0x800) {
+        put(static_cast<char>(0xC0 | (ch >> 6)));
+        put(static_cast<char>(0x80 | (ch & 0x3F)));
+      }
+      else if(ch < 0x10000) {
+        put(static_cast<char>(0xE0 | (ch >> 12)));
+        put(static_cast<char>(0x80 | ((ch >> 6) & 0x3F)));
+        put(static_cast<char>(0x80 | (ch & 0x3F)));
+      }
+      else {
+        put(static_cast<char>(0xF0 | (ch >> 18)));
+        put(static_cast<char>(0x80 | ((ch >> 12) & 0x3F)));
+        put(static_cast<char>(0x80 | ((ch >> 6) & 0x3F)));
+        put(static_cast<char>(0x80 | (ch & 0x3F)));
+      }
     }
-    window.draw(name_);
   }
 };
 
@@ -586,13 +1231,71 @@ void load(Tree& tree) {
   rapidjson::FileReadStream fileStream(file, buff, sizeof(buff));
   rapidjson::EncodedInputStream<rapidjson::UTF16LE<>, rapidjson::FileReadStream> encodedInputStream(fileStream);
   rapidjson::GenericDocument<rapidjson::UTF16LE<>> json;
-  json.ParseStream(encodedInputStream);
+  json.ParseStream<rapidjson::kParseIterativeFlag>(encodedInputStream);
 
   tree.load(json);
 
   fclose(file);
 }
 
+typedef rapidjson::EncodedOutputStream<rapidjson::UTF16LE<>, rapidjson::MemoryBuffer> ChunkStream;
+typedef rapidjson::Writer<ChunkStream, rapidjson::UTF16LE<>, rapidjson::UTF16LE<>> ChunkWriter;
+
+//Part of the saved file: JSON skeleton between subtrees, or a run of
+//adjacent sibling subtrees with the commas between them
+struct Chunk {
+  std::vector<const Tree*> nodes;
+  std::size_t weight = 0;
+  bool isComma = false; //Starts with comma before the first node
+  rapidjson::MemoryBuffer buffer;
+};
+
+//Splits folders heavier than limit into skeleton chunks around their children
+//and groups other adjacent subtrees into chunks of up to limit items
+void plan(const Tree& tree, std::size_t limit, std::deque<Chunk>& chunks) {
+  auto literal = [&chunks]() -> rapidjson::MemoryBuffer& {
+    if(chunks.empty() || !chunks.back().nodes.empty()) {
+      chunks.emplace_back();
+    }
+    return chunks.back().buffer;
+  };
+
+  {
+    //Same BOM as the sequential writer
+    ChunkStream stream(literal(), true);
+  }
+
+  //Children already planned for each split folder on the current path
+  std::vector<std::size_t> counts;
+  Tree::traverse(tree, [&](const Tree& node, std::size_t depth) {
+    const bool isComma = depth != 0 && counts[depth - 1]++ != 0;
+    if(!node.getIsFolder() || node.getTotalCount() <= limit) {
+      const std::size_t weight = node.getTotalCount() + 1;
+      //Only siblings join a group, they are separated by commas
+      if(chunks.back().nodes.empty() || !isComma || chunks.back().weight + weight > limit) {
+        chunks.emplace_back();
+        chunks.back().isComma = isComma;
+      }
+      chunks.back().nodes.push_back(&node);
+      chunks.back().weight += weight;
+      return false;
+    }
+    ChunkStream stream(literal(), false);
+    if(isComma) {
+      stream.Put(L',');
+    }
+    ChunkWriter writer(stream);
+    node.saveHead(writer);
+    counts.resize(depth);
+    counts.push_back(0);
+    return true;
+  }, [&literal](const Tree&, std::size_t) {
+    ChunkStream stream(literal(), false);
+    stream.Put(L']');
+    stream.Put(L'}');
+  });
+}
+
 void save(const Tree& tree) {
   FILE* file;
   _wfopen_s(&file, L"progress.json", L"w");
@@ -602,18 +1305,590 @@ void save(const Tree& tree) {
     return;
   }
 
-  char buff[1024]{};
-  rapidjson::FileWriteStream fileStream(file, buff, sizeof(buff));
-  rapidjson::EncodedOutputStream<rapidjson::UTF16LE<>, rapidjson::FileWriteStream> encodedOutputStream(fileStream);
-  rapidjson::Writer<rapidjson::EncodedOutputStream<rapidjson::UTF16LE<>, rapidjson::FileWriteStream>, rapidjson::UTF16LE<>, rapidjson::UTF16LE<>> writer(encodedOutputStream);
+  const unsigned threads = std::max(std::thread::hardware_concurrency(), 1U);
+  if(threads == 1 || tree.getTotalCount() < 65536) {
+    std::vector<char> buff(65536);
+    rapidjson::FileWriteStream fileStream(file, buff.data(), buff.size());
+    rapidjson::EncodedOutputStream<rapidjson::UTF16LE<>, rapidjson::FileWriteStream> encodedOutputStream(fileStream);
+    rapidjson::Writer<rapidjson::EncodedOutputStream<rapidjson::UTF16LE<>, rapidjson::FileWriteStream>, rapidjson::UTF16LE<>, rapidjson::UTF16LE<>> writer(encodedOutputStream);
 
-  writer.StartObject();
-  tree.save(writer);
-  writer.EndObject();
+    tree.save(writer);
+  }
+  else {
+    //Encode subtrees on all cores, then write buffers in order
+    std::deque<Chunk> chunks;
+    plan(tree, std::max<std::size_t>(tree.getTotalCount() / (threads * 8), 1024), chunks);
+
+    std::atomic<std::size_t> next(0);
+    auto work = [&chunks, &next]() {
+      for(std::size_t i = next++; i < chunks.size(); i = next++) {
+        Chunk& chunk = chunks[i];
+        if(chunk.nodes.empty()) {
+          continue;
+        }
+        ChunkStream stream(chunk.buffer, false);
+        ChunkWriter writer(stream);
+        for(std::size_t j = 0; j < chunk.nodes.size(); ++j) {
+          if(j != 0 || chunk.isComma) {
+            stream.Put(L',');
+          }
+          writer.Reset(stream);
+          chunk.nodes[j]->save(writer);
+        }
+      }
+    };
+    std::vector<std::thread> workers;
+    workers.reserve(threads - 1);
+    for(unsigned i = 1; i < threads; ++i) {
+      workers.emplace_back(work);
+    }
+    work();
+    for(auto& i : workers) {
+      i.join();
+    }
+
+    //Few large chunks, small skeleton pieces are coalesced by the file buffer
+    setvbuf(file, nullptr, _IOFBF, 1 << 20);
+    for(auto& i : chunks) {
+      fwrite(i.buffer.GetBuffer(), 1, i.buffer.GetSize(), file);
+    }
+  }
 
   fclose(file);
 }
 
+void report(const Tree& tree, ReportFormat format, bool incompleteOnly, std::size_t maxDepth = SIZE_MAX) {
+  const wchar_t* path = L"progress.csv";
+  if(format == ReportFormat::Markdown) {
+    path = L"progress.md";
+  }
+  else if(format == ReportFormat::HTML) {
+    path = L"progress.html";
+  }
+
+  FILE* file;
+  _wfopen_s(&file, path, L"w");
+
+  if(!file) {
+    warning(std::wstring(L"Cannot open ") + path + L" for report");
+    return;
+  }
+
+  {
+    Report writer(file, format);
+    writer.write(tree, incompleteOnly, maxDepth);
+  }
+
+  fclose(file);
+}
+
+//Lock-free ring buffer for exactly one producer and one consumer thread
+template<typename T>
+class Queue {
+  std::vector<T> data_;
+  alignas(64) std::atomic<std::size_t> head_{0}; //Next to pop, owned by consumer
+  alignas(64) std::atomic<std::size_t> tail_{0}; //Next to push, owned by producer
+public:
+  Queue(std::size_t capacity) : data_(capacity + 1) {
+  }
+
+  //Moves value in only on success
+  bool push(T& value) {
+    const std::size_t tail = tail_.load(std::memory_order_relaxed);
+    const std::size_t next = tail + 1 == data_.size() ? 0 : tail + 1;
+    if(next == head_.load(std::memory_order_acquire)) {
+      return false;
+    }
+    data_[tail] = std::move(value);
+    tail_.store(next, std::memory_order_release);
+    return true;
+  }
+
+  bool pop(T& value) {
+    const std::size_t head = head_.load(std::memory_order_relaxed);
+    if(head == tail_.load(std::memory_order_acquire)) {
+      return false;
+    }
+    value = std::move(data_[head]);
+    head_.store(head + 1 == data_.size() ? 0 : head + 1, std::memory_order_release);
+    return true;
+  }
+};
+
+//Local server on a Unix domain socket. Requests are lines of tab separated fields:
+//  d <path> <0|1>  set check mark
+//  r <path> <name> rename
+//  a <path> <name> add item to folder
+//  f <path> <name> add folder to folder
+//  x <path>        delete
+//  p <path>        query percent
+//Path is names separated by '/', empty path is the root. Every request is answered
+//in order with "ok", "ok <percent>" or "error <message>" line.
+//Socket thread parses requests, UI thread applies them in batches in update().
+class Server {
+  enum class Command : uint8_t {
+    Invalid,
+    Done,
+    Rename,
+    Add,
+    AddFolder,
+    Delete,
+    Percent
+  };
+
+  struct Request {
+    uint32_t client = 0;
+    Command command = Command::Invalid;
+    std::string path;
+    std::string arg;
+  };
+
+  struct Reply {
+    uint32_t client = 0;
+    std::string text;
+  };
+
+  struct Client {
+    SOCKET socket = INVALID_SOCKET;
+    std::string input;
+    std::string output;
+    std::size_t waiting = 0; //Requests sent to UI thread and not answered yet
+    bool isClosed = false;   //Client shut down sending, close after last reply
+  };
+
+  static constexpr std::size_t queueSize_ = 65536;
+  static constexpr std::size_t lineSize_ = 4096;
+  static constexpr std::size_t outputSize_ = 1 << 20;
+  static constexpr int pollTimeout_ = 1000; //Socket thread is woken by wake() before that
+
+  Queue<Request> requests_;
+  Queue<Reply> replies_;
+  std::deque<Reply> pending_; //Replies waiting for queue space, UI thread only
+  std::unordered_map<Tree*, std::size_t> dirty_; //Rows with stale percent and their depth
+  std::unordered_set<Tree*> touched_;             //Rows with stale vertices
+  std::thread thread_;
+  std::atomic<bool> isRunning_{false};
+  bool isStarted_ = false;
+  SOCKET listener_ = INVALID_SOCKET;
+  SOCKET wake_ = INVALID_SOCKET; //Loopback datagram socket polled with the clients
+  sockaddr_in wakeAddress_{};
+  std::string path_;
+public:
+  Server() : requests_(queueSize_), replies_(queueSize_) {
+  }
+
+  ~Server() {
+    stop();
+  }
+
+  bool start(const char* path) {
+    WSADATA data;
+    if(WSAStartup(MAKEWORD(2, 2), &data) != 0) {
+      return false;
+    }
+    isStarted_ = true;
+
+    listener_ = socket(AF_UNIX, SOCK_STREAM, 0);
+    if(listener_ == INVALID_SOCKET) {
+      return false;
+    }
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    strncpy_s(address.sun_path, sizeof(address.sun_path), path, _TRUNCATE);
+    DeleteFileA(path);
+    if(bind(listener_, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == SOCKET_ERROR) {
+      return false;
+    }
+    path_ = path;
+    if(listen(listener_, SOMAXCONN) == SOCKET_ERROR) {
+      return false;
+    }
+    u_long mode = 1;
+    ioctlsocket(listener_, FIONBIO, &mode);
+
+    wake_ = socket(AF_INET, SOCK_DGRAM, 0);
+    if(wake_ == INVALID_SOCKET) {
+      return false;
+    }
+    wakeAddress_.sin_family = AF_INET;
+    wakeAddress_.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    int size = sizeof(wakeAddress_);
+    if(bind(wake_, reinterpret_cast<sockaddr*>(&wakeAddress_), size) == SOCKET_ERROR) {
+      return false;
+    }
+    if(getsockname(wake_, reinterpret_cast<sockaddr*>(&wakeAddress_), &size) == SOCKET_ERROR) {
+      return false;
+    }
+    ioctlsocket(wake_, FIONBIO, &mode);
+
+    isRunning_ = true;
+    thread_ = std::thread(&Server::run, this);
+    return true;
+  }
+
+  void stop() {
+    isRunning_ = false;
+    if(thread_.joinable()) {
+      wake();
+      thread_.join();
+    }
+    if(listener_ != INVALID_SOCKET) {
+      closesocket(listener_);
+      listener_ = INVALID_SOCKET;
+    }
+    if(wake_ != INVALID_SOCKET) {
+      closesocket(wake_);
+      wake_ = INVALID_SOCKET;
+    }
+    if(!path_.empty()) {
+      DeleteFileA(path_.c_str());
+      path_.clear();
+    }
+    if(isStarted_) {
+      WSACleanup();
+      isStarted_ = false;
+    }
+  }
+
+  //Applies one batch of queued requests, returns true if the tree changed
+  bool update(Tree& tree) {
+    bool replied = false;
+    while(!pending_.empty() && replies_.push(pending_.front())) {
+      pending_.pop_front();
+      replied = true;
+    }
+    if(!pending_.empty()) {
+      if(replied) {
+        wake();
+      }
+      return false;
+    }
+
+    bool changed = false;
+    bool relayout = false;
+    Request request;
+    for(std::size_t i = 0; i < queueSize_ && requests_.pop(request); ++i) {
+      Reply reply;
+      reply.client = request.client;
+      reply.text = apply(tree, request, changed, relayout);
+      if(!replies_.push(reply)) {
+        pending_.push_back(std::move(reply));
+        break;
+      }
+      replied = true;
+    }
+    if(replied) {
+      wake();
+    }
+    //Vertices once per touched row, rows below structural changes once per batch
+    percentCompute();
+    for(Tree* i : touched_) {
+      i->percentRebuild();
+    }
+    touched_.clear();
+    if(relayout) {
+      tree.reflow();
+    }
+    return changed;
+  }
+private:
+
+  //Ends WSAPoll in the socket thread so it picks up new replies
+  void wake() {
+    const char byte = 0;
+    sendto(wake_, &byte, 1, 0, reinterpret_cast<const sockaddr*>(&wakeAddress_), sizeof(wakeAddress_));
+  }
+
+  //Recomputes percents of rows changed since last call, deepest first
+  void percentCompute() {
+    std::vector<std::pair<Tree*, std::size_t>> rows(dirty_.begin(), dirty_.end());
+    std::sort(rows.begin(), rows.end(), [](const std::pair<Tree*, std::size_t>& a, const std::pair<Tree*, std::size_t>& b) {
+      return a.second > b.second;
+    });
+    for(auto& i : rows) {
+      i.first->percentCompute();
+    }
+    dirty_.clear();
+  }
+
+  //Marks path rows for percent update, stops at rows already marked
+  void mark(const std::vector<Tree*>& path, bool isChanged) {
+    for(std::size_t i = path.size(); i-- != 0;) {
+      if(!dirty_.emplace(path[i], i).second) {
+        break;
+      }
+    }
+    for(std::size_t i = path.size(); i-- != 0;) {
+      if(!touched_.insert(path[i]).second) {
+        break;
+      }
+    }
+    if(isChanged) {
+      for(std::size_t i = path.size(); i-- != 0;) {
+        if(path[i]->getChanged()) {
+          break;
+        }
+        path[i]->setChanged();
+      }
+    }
+  }
+
+  std::string apply(Tree& tree, const Request& request, bool& changed, bool& relayout) {
+    if(request.command == Command::Invalid) {
+      return "error\tbad request\n";
+    }
+
+    std::vector<Tree*> path(1, &tree);
+    std::size_t begin = 0;
+    while(begin < request.path.size()) {
+      std::size_t end = request.path.find('/', begin);
+      if(end == std::string::npos) {
+        end = request.path.size();
+      }
+      if(end != begin) {
+        Tree* child = path.back()->getChild(sf::String::fromUtf8(request.path.begin() + begin, request.path.begin() + end).toWideString());
+        if(!child) {
+          return "error\tno such item\n";
+        }
+        path.push_back(child);
+      }
+      begin = end + 1;
+    }
+
+    Tree* node = path.back();
+    switch(request.command) {
+      case Command::Done:
+        if(node->getIsFolder()) {
+          return "error\tnot an item\n";
+        }
+        if(request.arg != "0" && request.arg != "1") {
+          return "error\tbad value\n";
+        }
+        node->setCheckValue(request.arg == "1");
+        mark(path, false);
+        break;
+      case Command::Rename:
+      {
+        sf::String name = sf::String::fromUtf8(request.arg.begin(), request.arg.end());
+        if(name.getSize() > 31) {
+          return "error\tname too long\n";
+        }
+        node->setName(name);
+        changed = true;
+        return "ok\n";
+      }
+      case Command::Add:
+      case Command::AddFolder:
+      {
+        sf::String name = sf::String::fromUtf8(request.arg.begin(), request.arg.end());
+        if(!node->getIsFolder()) {
+          return "error\tnot a folder\n";
+        }
+        if(name.getSize() > 31) {
+          return "error\tname too long\n";
+        }
+        Tree* child = node->add(request.command == Command::AddFolder);
+        child->setName(name);
+        child->setChanged();
+        mark(path, true);
+        relayout = true;
+        break;
+      }
+      case Command::Delete:
+        if(path.size() == 1) {
+          return "error\tcannot delete root\n";
+        }
+        node->setDeleted();
+        path.pop_back();
+        mark(path, true);
+        relayout = true;
+        break;
+      case Command::Percent:
+        percentCompute();
+        return "ok\t" + std::to_string(node->getIsFolder() ? node->getPercent() : (node->getCheckValue() ? 100 : 0)) + "\n";
+    }
+
+    changed = true;
+    return "ok\n";
+  }
+
+  static Request parse(uint32_t client, const char* begin, const char* end) {
+    Request request;
+    request.client = client;
+    if(end != begin && *(end - 1) == '\r') {
+      --end;
+    }
+    if(end - begin < 2 || begin[1] != '\t') {
+      return request;
+    }
+    const char* path = begin + 2;
+    const char* tab = std::find(path, end, '\t');
+    request.path.assign(path, tab);
+    if(tab != end) {
+      request.arg.assign(tab + 1, end);
+    }
+    switch(*begin) {
+      case 'd':
+        request.command = Command::Done;
+        break;
+      case 'r':
+        request.command = Command::Rename;
+        break;
+      case 'a':
+        request.command = Command::Add;
+        break;
+      case 'f':
+        request.command = Command::AddFolder;
+        break;
+      case 'x':
+        request.command = Command::Delete;
+        break;
+      case 'p':
+        request.command = Command::Percent;
+        break;
+    }
+    return request;
+  }
+
+  void run() {
+    std::unordered_map<uint32_t, Client> clients;
+    std::vector<WSAPOLLFD> fds;
+    std::vector<uint32_t> ids;
+    std::deque<Request> backlog; //Parsed requests waiting for queue space
+    uint32_t nextId = 0;
+    std::vector<char> buff(65536);
+
+    auto drop = [&clients](uint32_t id) {
+      closesocket(clients[id].socket);
+      clients.erase(id);
+    };
+
+    auto submit = [this, &backlog](uint32_t id, Client& client, const char* begin, const char* end) {
+      Request request = parse(id, begin, end);
+      if(!backlog.empty() || !requests_.push(request)) {
+        backlog.push_back(std::move(request));
+      }
+      ++client.waiting;
+    };
+
+    while(isRunning_) {
+      while(!backlog.empty() && requests_.push(backlog.front())) {
+        backlog.pop_front();
+      }
+      Reply reply;
+      while(replies_.pop(reply)) {
+        auto i = clients.find(reply.client);
+        if(i != clients.end()) {
+          i->second.output += reply.text;
+          --i->second.waiting;
+        }
+      }
+
+      //Stop reading while UI thread is behind or client does not read replies
+      fds.clear();
+      ids.clear();
+      fds.push_back(WSAPOLLFD{listener_, POLLRDNORM, 0});
+      ids.push_back(0);
+      fds.push_back(WSAPOLLFD{wake_, POLLRDNORM, 0});
+      ids.push_back(0);
+      for(auto i = clients.begin(); i != clients.end();) {
+        if(i->second.isClosed && i->second.waiting == 0 && i->second.output.empty()) {
+          closesocket(i->second.socket);
+          i = clients.erase(i);
+        }
+        else {
+          ++i;
+        }
+      }
+      for(auto& i : clients) {
+        SHORT events = !i.second.isClosed && backlog.empty() && i.second.output.size() < outputSize_ ? POLLRDNORM : 0;
+        if(!i.second.output.empty()) {
+          events |= POLLWRNORM;
+        }
+        //Nothing to do for closed client until its replies arrive
+        if(events == 0 && i.second.isClosed) {
+          continue;
+        }
+        fds.push_back(WSAPOLLFD{i.second.socket, events, 0});
+        ids.push_back(i.first);
+      }
+      if(WSAPoll(fds.data(), static_cast<ULONG>(fds.size()), pollTimeout_) <= 0) {
+        continue;
+      }
+
+      if(fds[0].revents & POLLRDNORM) {
+        SOCKET socket;
+        while((socket = accept(listener_, nullptr, nullptr)) != INVALID_SOCKET) {
+          u_long mode = 1;
+          ioctlsocket(socket, FIONBIO, &mode);
+          clients[++nextId].socket = socket;
+        }
+      }
+
+      if(fds[1].revents & POLLRDNORM) {
+        while(recv(wake_, buff.data(), static_cast<int>(buff.size()), 0) > 0) {
+        }
+      }
+
+      for(std::size_t i = 2; i < fds.size(); ++i) {
+        if(fds[i].revents == 0) {
+          continue;
+        }
+        Client& client = clients[ids[i]];
+        if(fds[i].revents & POLLERR) {
+          drop(ids[i]);
+          continue;
+        }
+        if(!client.isClosed && (fds[i].revents & (POLLRDNORM | POLLHUP))) {
+          const int size = recv(client.socket, buff.data(), static_cast<int>(buff.size()), 0);
+          if(size == 0) {
+            //Half-close, last line may lack '\n' and replies are still delivered
+            if(!client.input.empty()) {
+              submit(ids[i], client, client.input.data(), client.input.data() + client.input.size());
+              client.input.clear();
+            }
+            client.isClosed = true;
+          }
+          else if(size < 0) {
+            if(WSAGetLastError() != WSAEWOULDBLOCK) {
+              drop(ids[i]);
+              continue;
+            }
+          }
+          else {
+            client.input.append(buff.data(), size);
+            std::size_t begin = 0;
+            std::size_t end;
+            while((end = client.input.find('\n', begin)) != std::string::npos) {
+              submit(ids[i], client, client.input.data() + begin, client.input.data() + end);
+              begin = end + 1;
+            }
+            client.input.erase(0, begin);
+            if(client.input.size() > lineSize_) {
+              drop(ids[i]);
+              continue;
+            }
+          }
+        }
+        if(!client.output.empty() && (fds[i].revents & (POLLWRNORM | POLLHUP))) {
+          const int size = send(client.socket, client.output.data(), static_cast<int>(client.output.size()), 0);
+          if(size == SOCKET_ERROR) {
+            if(WSAGetLastError() != WSAEWOULDBLOCK) {
+              drop(ids[i]);
+            }
+            continue;
+          }
+          client.output.erase(0, size);
+        }
+      }
+    }
+
+    for(auto& i : clients) {
+      closesocket(i.second.socket);
+    }
+  }
+};
+
 #ifdef DEBUG
 int main() {
 #else
@@ -656,16 +1931,37 @@ int APIENTRY WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLi
 
   Tree tree;
   tree.setRoot();
+#ifdef DEBUG
+  sf::Clock benchmark;
+#endif // DEBUG
   load(tree);
+#ifdef DEBUG
+  std::wcout << L"load: " << benchmark.restart().asMicroseconds() << L" us" << std::endl;
+#endif // DEBUG
   tree.setPosition(sf::Vector2i(5, 5));
+#ifdef DEBUG
+  std::wcout << L"setPosition: " << benchmark.restart().asMicroseconds() << L" us" << std::endl;
+  std::size_t nodes = 0;
+  Tree::traverse(static_cast<const Tree&>(tree), [&nodes](const Tree&, std::size_t) {
+    ++nodes;
+    return true;
+  }, [](const Tree&, std::size_t) {
+  });
+  const sf::Int64 elapsed = std::max<sf::Int64>(benchmark.restart().asMicroseconds(), 1);
+  std::wcout << L"traverse: " << nodes << L" nodes in " << elapsed << L" us, " << nodes * 1000000 / elapsed << L" nodes/s" << std::endl;
+#endif // DEBUG
 
   sf::View view;
   view.setCenter(400, 300);
   view.setSize(800, 600);
 
-  uint32_t width = 400;
-  uint32_t minHeight = static_cast<uint32_t>(view.getSize().y / 2);
-  uint32_t pos = 0;
+  const float width = 400.0F;
+  const float minHeight = view.getSize().y / 2.0F;
+  const float scrollStep = 60.0F;     //Distance of one wheel notch
+  const float scrollFriction = 8.0F;  //Velocity decay per second
+  float scroll = view.getCenter().y;
+  float velocity = 0.0F;
+  std::size_t reportDepth = SIZE_MAX;
 
   sf::ContextSettings contextSettings;
   contextSettings.antialiasingLevel = 4;
@@ -676,6 +1972,19 @@ int APIENTRY WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLi
   window.setIcon(icon.getSize().x, icon.getSize().y, icon.getPixelsPtr());
   window.setVerticalSyncEnabled(true);
 
+  TileCache tileCache(sf::Color(0, 0, 128));
+  tiles = &tileCache;
+
+  std::unique_ptr<Server> server;
+  if(wcsstr(GetCommandLineW(), L"--server")) {
+    server.reset(new Server);
+    if(!server->start("progress.sock")) {
+      warning(L"Cannot start local server, running without it");
+      server.reset();
+    }
+  }
+
+  sf::Clock clock;
   bool redraw = true;
   while(window.isOpen()) {
     while(window.pollEvent(event)) {
@@ -684,52 +1993,82 @@ int APIENTRY WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLi
           window.close();
           break;
         case sf::Event::MouseWheelScrolled:
-          event.mouseWheelScroll.delta *= 20;
-          pos = static_cast<uint32_t>(view.getCenter().y);
-          view.setCenter(static_cast<float>(width), pos - event.mouseWheelScroll.delta);
-          if(pos - event.mouseWheelScroll.delta < minHeight) {
-            view.setCenter(static_cast<float>(width), static_cast<float>(minHeight));
-          }
-          redraw = true;
+          //Impulse that travels scrollStep per notch while decaying
+          velocity -= event.mouseWheelScroll.delta * scrollStep * scrollFriction;
           break;
         case sf::Event::KeyPressed:
           switch(event.key.code) {
             case sf::Keyboard::Key::Up:
-              pos = static_cast<uint32_t>(view.getCenter().y);
-              if(pos - 10 < minHeight) {
-                view.setCenter(static_cast<float>(width), static_cast<float>(minHeight));
-              }
-              else {
-                view.setCenter(static_cast<float>(width), static_cast<float>(view.getCenter().y - 10));
-              }
+              velocity -= scrollStep / 2.0F * scrollFriction;
               break;
             case sf::Keyboard::Key::Down:
-              pos = static_cast<uint32_t>(view.getCenter().y);
-              if(pos + 10 < minHeight) {
-                view.setCenter(static_cast<float>(width), static_cast<float>(minHeight));
+              velocity += scrollStep / 2.0F * scrollFriction;
+              break;
+            case sf::Keyboard::Key::F5:
+              report(tree, ReportFormat::CSV, event.key.shift, reportDepth);
+              break;
+            case sf::Keyboard::Key::F6:
+              report(tree, ReportFormat::Markdown, event.key.shift, reportDepth);
+              break;
+            case sf::Keyboard::Key::F7:
+              report(tree, ReportFormat::HTML, event.key.shift, reportDepth);
+              break;
+            case sf::Keyboard::Key::F8:
+              //Cycle report depth limit 1..9, then unlimited
+              reportDepth = reportDepth == SIZE_MAX ? 1 : (reportDepth >= 9 ? SIZE_MAX : reportDepth + 1);
+              if(reportDepth == SIZE_MAX) {
+                window.setTitle("Progress");
               }
               else {
-                view.setCenter(static_cast<float>(width), static_cast<float>(view.getCenter().y + 10));
+                window.setTitle("Progress - report depth " + std::to_string(reportDepth));
               }
               break;
           }
-          redraw = true;
           break;
       }
       redraw = tree.event(event, window) || redraw;
     }
 
+    if(server) {
+      redraw = server->update(tree) || redraw;
+    }
+
+    const float elapsed = std::min(clock.restart().asSeconds(), 0.05F);
+    if(velocity != 0.0F) {
+      scroll += velocity * elapsed;
+      velocity *= std::exp(-scrollFriction * elapsed);
+      if(std::abs(velocity) < 5.0F) {
+        velocity = 0.0F;
+      }
+      if(scroll < minHeight) {
+        scroll = minHeight;
+        velocity = 0.0F;
+      }
+      view.setCenter(width, std::round(scroll));
+      redraw = true;
+    }
+
     if(redraw) {
       redraw = false;
       window.clear(sf::Color(0, 0, 128));
       window.setView(view);
-      tree.draw(window);
+      tileCache.draw(window, tree);
       window.display();
     }
     else {
       sf::sleep(sf::milliseconds(15));
     }
   }
+  if(server) {
+    server->stop();
+  }
+  tiles = nullptr;
+#ifdef DEBUG
+  benchmark.restart();
+#endif // DEBUG
   save(tree);
+#ifdef DEBUG
+  std::wcout << L"save: " << benchmark.restart().asMicroseconds() << L" us" << std::endl;
+#endif // DEBUG
   return EXIT_SUCCESS;
 }
\ No newline at end of file